@@ -41,9 +41,19 @@ And as for the coalescing strategy, I used
 #include <unistd.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 #include "mm.h"
 #include "memlib.h"
+#include "mm_ext.h"
 
 /*
  * If you want debugging output, uncomment the following.  Be sure not
@@ -88,12 +98,33 @@ typedef uint64_t word_t;
 static const size_t wsize = sizeof(word_t);   // word and header size (bytes)
 static const size_t dsize = 2*wsize;          // double word size (bytes)
 static const size_t min_block_size = 2*dsize; // Minimum block size
+
+/* mm_ext.h repeats the layout for mm_malloc_fixed; keep the two in step */
+_Static_assert(sizeof(word_t) == MM_WSIZE, "MM_WSIZE must match wsize");
+_Static_assert(2*sizeof(word_t) == MM_DSIZE, "MM_DSIZE must match dsize");
+_Static_assert(MM_DSIZE == ALIGNMENT, "MM_DSIZE must match ALIGNMENT");
+_Static_assert(4*sizeof(word_t) == MM_MIN_BLOCK_SIZE,
+               "MM_MIN_BLOCK_SIZE must match min_block_size");
 static const size_t chunksize = (1 << 12);    // requires (chunksize % 16 == 0)
 
 static const word_t alloc_mask = 0x1;
 static const word_t prev_alloc_mask = 0x2;
 static const word_t size_mask = ~(word_t)0xF;
 
+/* Relocation hint regions: 1MB each, enough entries for a 16GB heap */
+#define REGION_SHIFT 20
+#define MAX_REGIONS (1 << 14)
+static const size_t region_size = ((size_t)1 << REGION_SHIFT);
+
+/* Background purge: free blocks this large carry a timestamp so their
+ * pages can be returned once they have been left alone long enough */
+#define PURGE_STEPS 32                              // ticks per decay interval
+static const size_t purge_min_size = 2*chunksize;
+static const uint64_t purge_default_decay_ms = 10000;
+
+/* Persistent heap: "mmheap" plus a format version */
+#define PERSIST_MAGIC 0x6d6d686561700002ULL
+
 typedef struct block
 {
     /* Header contains size + allocation flag */
@@ -109,6 +140,25 @@ typedef struct block
 
 } block_t;
 
+/* a free block holds header, prev, next and footer */
+_Static_assert(sizeof(block_t) + sizeof(word_t) == MM_MIN_BLOCK_SIZE,
+               "min_block_size must fit a free block");
+
+/* Header in the first page of a persistent heap file. The heap itself
+ * starts on the next page. */
+typedef struct
+{
+    word_t magic;
+    word_t base;         // address the file was mapped at
+    word_t brk;          // bytes of heap in use
+    word_t clean;        // set when the globals below were saved on close
+    void *root;          // application's root object, see mm_persist_root
+    block_t *heap_listp;
+    block_t *blockpointer;
+    block_t *begin[MM_NUM_CLASSES];
+    block_t *end[MM_NUM_CLASSES];
+} persist_header_t;
+
 /* Global variables */
 /* Pointer to first block */
 static block_t *heap_listp = NULL;
@@ -116,16 +166,46 @@ static block_t *heap_listp = NULL;
 // static block_t *end = NULL;
 static block_t *blockpointer = NULL;
 //initialize list of begin and end for segragated list
-static block_t *begin[19];
-static block_t *end[19];
+static block_t *begin[MM_NUM_CLASSES];
+static block_t *end[MM_NUM_CLASSES];
+//live (allocated) bytes in each region of the heap
+static uint32_t region_live[MAX_REGIONS];
+//background purge thread state, all guarded by heap_mutex while running
+static pthread_mutex_t heap_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t purge_cond;
+static pthread_t purge_thread;
+static bool purge_running = false;
+static bool purge_paused = false;
+static bool purge_stop = false;
+static uint64_t purge_decay_ns = 0;
+static size_t page_size = 0;
+//latency histograms, and the path taken by the last malloc or realloc
+static bool latency_on = false;
+static mm_lat_hist_t latency[MM_LAT_NSERIES];
+static int op_path = MM_LAT_MALLOC_FIT;
+//persistent heap mapping, NULL when the heap comes from mem_sbrk
+static persist_header_t *persist = NULL;
+static int persist_fd = -1;
+static size_t persist_size = 0;
+static size_t persist_hsize = 0;
 
 /* Function prototypes for internal helper routines */
+static bool do_init(void);
+static void *do_malloc(size_t size);
+static void *alloc_block(size_t asize, int index);
+static void do_free(void *ptr);
+static void *do_realloc(void *oldptr, size_t size);
+static void *do_calloc(size_t nmemb, size_t size);
+static bool heap_lock(void);
+static void heap_unlock(bool locked);
+
 static block_t *extend_heap(size_t size);
 static void place(block_t *block, size_t asize);
-static block_t *find_fit(size_t asize);
+static block_t *find_fit(size_t asize, int index);
 static block_t *coalesce(block_t *block);
 
 static size_t max(size_t x, size_t y);
+static size_t adjust_size(size_t size);
 static size_t round_up(size_t size, size_t n);
 static word_t pack(size_t size, bool prev_alloc, bool alloc);
 
@@ -151,6 +231,26 @@ bool mm_checkheap(int lineno);
 static int blockindex(size_t size);
 static bool get_prev_alloc(block_t *block);
 static bool extract_prev_alloc(word_t word);
+static size_t heap_offset(const void *p);
+static size_t heap_size(void);
+static size_t region_span(size_t r);
+static void account_region(block_t *block, size_t size, bool alloc);
+static uint64_t now_ns(void);
+static word_t *purge_meta(block_t *block);
+static size_t purge_pages(block_t *block, size_t *hi);
+static word_t purged_pages(block_t *block);
+static void carry_purged(block_t *block, word_t purged);
+static size_t purge_block(block_t *block, uint64_t now, bool force);
+static size_t purge_heap(bool force);
+static void *purge_main(void *arg);
+static uint64_t cycles(void);
+static int latency_bucket(uint64_t t);
+static void record_latency(int series, uint64_t start);
+static void *heap_sbrk(size_t size);
+static void persist_save(void);
+static void persist_exit(void);
+static void persist_rebuild(void);
+static bool write_all(int fd, const void *buf, size_t n);
 /* rounds up to the nearest multiple of ALIGNMENT */
 static size_t align(size_t x) {
     return ALIGNMENT * ((x+ALIGNMENT-1)/ALIGNMENT);
@@ -159,10 +259,83 @@ static size_t align(size_t x) {
 /*
  * Initialize: return false on error, true on success.
  */
-bool mm_init(void) 
+bool mm_init(void)
+{
+    bool locked = heap_lock();
+    bool ok = do_init();
+    heap_unlock(locked);
+    return ok;
+}
+
+/*
+ * The latency of each call, including any wait for heap_mutex, is recorded
+ * under the path do_malloc/do_realloc report in op_path.
+ */
+void *malloc(size_t size)
+{
+    uint64_t start = latency_on ? cycles() : 0;
+    bool locked = heap_lock();
+    void *bp = do_malloc(size);
+    if (latency_on)
+    {
+        record_latency(op_path, start);
+    }
+    heap_unlock(locked);
+    return bp;
+}
+
+void free(void *ptr)
+{
+    uint64_t start = latency_on ? cycles() : 0;
+    bool locked = heap_lock();
+    do_free(ptr);
+    if (latency_on)
+    {
+        record_latency(MM_LAT_FREE, start);
+    }
+    heap_unlock(locked);
+}
+
+void *realloc(void *oldptr, size_t size)
+{
+    uint64_t start = latency_on ? cycles() : 0;
+    bool locked = heap_lock();
+    void *newptr = do_realloc(oldptr, size);
+    if (latency_on)
+    {
+        record_latency(op_path, start);
+    }
+    heap_unlock(locked);
+    return newptr;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    uint64_t start = latency_on ? cycles() : 0;
+    bool locked = heap_lock();
+    void *bp = do_calloc(nmemb, size);
+    if (latency_on)
+    {
+        record_latency(op_path == MM_LAT_MALLOC_EXTEND ?
+                       MM_LAT_CALLOC_EXTEND : MM_LAT_CALLOC_FIT, start);
+    }
+    heap_unlock(locked);
+    return bp;
+}
+
+/*
+ * do_init: creates the initial empty heap.
+ */
+static bool do_init(void)
 {
     // Create the initial empty heap 
-    word_t *start = (word_t *)(mem_sbrk(2*wsize));
+    if (persist != NULL)
+    {
+        persist->brk = 0;
+        persist->root = NULL;
+    }
+    blockpointer = NULL;
+    word_t *start = (word_t *)(heap_sbrk(2*wsize));
 
     if (start == (void *)-1) 
     {
@@ -170,11 +343,15 @@ bool mm_init(void)
     }
     // initialize the segragated list
     int i;
-    for(i = 0; i<19; ++i){
+    for(i = 0; i<MM_NUM_CLASSES; ++i){
 
         begin[i] = NULL;
         end[i] = NULL;
     }
+    for(i = 0; i<MAX_REGIONS; ++i){
+
+        region_live[i] = 0;
+    }
 
     start[0] = pack(0, true, true); // Prologue footer
     start[1] = pack(0, true, true); // Epilogue header
@@ -189,37 +366,100 @@ bool mm_init(void)
     return true;
 }
 
-void *malloc(size_t size) 
+/*
+ * mm_malloc_class: entry point for mm_malloc_fixed in mm_ext.h, which has
+ *                  already turned the request into a block size and its
+ *                  size class at compile time. Every block in the next
+ *                  class up is larger than asize, so its head is taken
+ *                  without searching; only when that list is empty does
+ *                  it fall back to find_fit and extend_heap. Returns NULL
+ *                  if asize and index do not belong together.
+ */
+void *mm_malloc_class(size_t asize, int index)
 {
-    dbg_requires(mm_checkheap);
-   
-    size_t asize;      // Adjusted block size
-    size_t extendsize; // Amount to extend heap if no fit is found
-    block_t *block;
-    void *bp = NULL;
+    if (index < 0 || index >= MM_NUM_CLASSES
+        || asize < min_block_size || asize % dsize != 0
+        || index != blockindex(asize))
+    {
+        return NULL;
+    }
 
-    if (heap_listp == NULL) // Initialize heap if it isn't initialized
+    uint64_t start = latency_on ? cycles() : 0;
+    bool locked = heap_lock();
+    void *bp;
+    block_t *block = NULL;
+    if (index < MM_NUM_CLASSES - 1)
+    {
+        block = begin[index+1];
+    }
+    if (block != NULL)
+    {
+        op_path = MM_LAT_MALLOC_FIT;
+        place(block, asize);
+        bp = header_to_payload(block);
+    }
+    else
+    {
+        bp = alloc_block(asize, index);
+    }
+    if (latency_on)
     {
-        mm_init();
+        record_latency(op_path, start);
     }
+    heap_unlock(locked);
+    return bp;
+}
+
+/*
+ * do_malloc
+ */
+static void *do_malloc(size_t size)
+{
+    size_t asize;      // Adjusted block size
 
     if (size == 0) // Ignore spurious request
     {
-        dbg_ensures(mm_checkheap);
-        return bp;
+        op_path = MM_LAT_MALLOC_FIT;
+        return NULL;
     }
    dbg_printf("initial asked size is %lu! \n",(word_t)size);
     // Adjust block size to include overhead and to meet alignment requirements
-    asize = round_up(size+wsize, dsize);
-    asize = max(asize, min_block_size);
+    asize = adjust_size(size);
+    if (asize == 0) // Too large to describe in a header
+    {
+        op_path = MM_LAT_MALLOC_FIT;
+        return NULL;
+    }
     dbg_printf("processed asize is %lu! \n",(word_t)asize);
+    return alloc_block(asize, blockindex(asize));
+}
+
+/*
+ * alloc_block: allocates a block of asize bytes, searching the free lists
+ *              from class index up and extending the heap if none fits.
+ */
+static void *alloc_block(size_t asize, int index)
+{
+    dbg_requires(mm_checkheap);
+
+    size_t extendsize; // Amount to extend heap if no fit is found
+    block_t *block;
+    void *bp = NULL;
+
+    op_path = MM_LAT_MALLOC_FIT;
+    if (heap_listp == NULL) // Initialize heap if it isn't initialized
+    {
+        do_init();
+    }
+
     // Search the free list for a fit
-    block = find_fit(asize);
+    block = find_fit(asize, index);
    // dbg_printf("Entering Malloc phase correctly\n");
     // If no fit is found, request more memory, and then and place the block
     if (block == NULL)
     {  
         dbg_printf("fit error! \n");
+        op_path = MM_LAT_MALLOC_EXTEND;
         extendsize = max(asize, chunksize);
         block = extend_heap(extendsize);
         if (block == NULL) // extend_heap returns an error
@@ -240,10 +480,10 @@ void *malloc(size_t size)
 } 
 
 /*
- * free
+ * do_free
  */
 
-void free(void *ptr)
+static void do_free(void *ptr)
 {
     if (ptr == NULL)
     {
@@ -254,6 +494,7 @@ void free(void *ptr)
     size_t size = get_size(block);
 
     bool boolprev = get_prev_alloc(block);
+    account_region(block, size, false);
     write_header(block, size, boolprev,false);
     write_footer(block, size, false);
     dbg_printf("Free size %zd on address %lu.\n", size,(word_t)block);
@@ -264,10 +505,12 @@ void free(void *ptr)
 }
 
 /*
- * realloc
+ * do_realloc: keeps the block in place when the new size still fits in it,
+ *          splitting off the tail as a free block when it is big enough.
+ *          Otherwise allocates a new block and copies.
  */
 
-void *realloc(void *oldptr, size_t size)
+static void *do_realloc(void *oldptr, size_t size)
 {
     block_t *block = payload_to_header(oldptr);
     size_t copysize;
@@ -276,59 +519,605 @@ void *realloc(void *oldptr, size_t size)
     // If size == 0, then free block and return NULL
     if (size == 0)
     {
-        free(oldptr);
+        do_free(oldptr);
+        op_path = MM_LAT_REALLOC_COPY;
         return NULL;
     }
 
     // If ptr is NULL, then equivalent to malloc
     if (oldptr == NULL)
     {
-        return malloc(size);
+        newptr = do_malloc(size);
+        op_path = MM_LAT_REALLOC_COPY;
+        return newptr;
+    }
+
+    // A size too large for any block fails, leaving the old one untouched
+    size_t asize = adjust_size(size);
+    if (asize == 0)
+    {
+        op_path = MM_LAT_REALLOC_COPY;
+        return NULL;
+    }
+
+    // If the new size fits in the current block, shrink it in place
+    size_t csize = get_size(block);
+    if (asize <= csize)
+    {
+        if ((csize - asize) >= min_block_size)
+        {
+            block_t *block_next;
+            bool boolprev = get_prev_alloc(block);
+            write_header(block, asize, boolprev, true);
+            block_next = find_next(block);
+            account_region(block_next, csize-asize, false);
+            if (block == blockpointer)
+            {
+                blockpointer = block_next;
+            }
+            write_header(block_next, csize-asize, true, false);
+            write_footer(block_next, csize-asize, false);
+            coalesce(block_next);
+        }
+        op_path = MM_LAT_REALLOC_INPLACE;
+        return oldptr;
     }
 
     // Otherwise, proceed with reallocation
-    newptr = malloc(size);
+    newptr = do_malloc(size);
+    op_path = MM_LAT_REALLOC_COPY;
     // If malloc fails, the original block is left untouched
     if (!newptr)
     {
-        return NULL;
+        return NULL;
+    }
+
+    // Copy the old data
+    copysize = get_payload_size(block); // gets size of old payload
+    if(size < copysize)
+    {
+        copysize = size;
+    }
+    memcpy(newptr, oldptr, copysize);
+
+    // Free the old block
+    do_free(oldptr);
+
+    return newptr;
+}
+/*
+ * do_calloc
+ * This function is not tested by mdriver
+ */
+static void *do_calloc(size_t nmemb, size_t size)
+{
+    void *bp;
+    size_t asize = nmemb * size;
+
+    if (nmemb == 0 || asize/nmemb != size)
+    {
+        // Nothing to allocate, or the multiplication overflowed
+        op_path = MM_LAT_MALLOC_FIT;
+        return NULL;
+    }
+
+    bp = do_malloc(asize);
+    if (bp == NULL)
+    {
+        return NULL;
+    }
+    // Initialize all bits to 0
+    memset(bp, 0, asize);
+
+    return bp;
+}
+
+/*
+ * mm_should_relocate: returns true if the block holding ptr lives in a region
+ *                     that is less than half used and find_fit would place a
+ *                     block of the same size in a different, denser region.
+ *                     If no fit exists the heap would grow, so the answer is
+ *                     false.
+ */
+bool mm_should_relocate(void *ptr)
+{
+    bool relocate = false;
+
+    if (ptr == NULL)
+    {
+        return false;
+    }
+
+    bool locked = heap_lock();
+    if (heap_listp != NULL)
+    {
+        block_t *block = payload_to_header(ptr);
+        size_t r = heap_offset(block) >> REGION_SHIFT;
+        size_t live = (r < MAX_REGIONS) ? region_live[r] : 0;
+        size_t span = (r < MAX_REGIONS) ? region_span(r) : 0;
+
+        if (r < MAX_REGIONS && 2 * live <= span)
+        {
+            size_t size = get_size(block);
+            block_t *fit = find_fit(size, blockindex(size));
+            size_t fr = (fit == NULL) ? MAX_REGIONS
+                                      : heap_offset(fit) >> REGION_SHIFT;
+            // compare live/span of both regions without dividing
+            relocate = fr != r && fr < MAX_REGIONS
+                && (size_t)region_live[fr] * span > live * region_span(fr);
+        }
+    }
+    heap_unlock(locked);
+    return relocate;
+}
+
+/*
+ * mm_region_stats: ranks the non-empty regions by utilization, lowest first,
+ *                  keeping the best n in stats by insertion. Ties go to the
+ *                  region with fewer live bytes, as it is cheaper to empty.
+ */
+size_t mm_region_stats(mm_region_stats_t *stats, size_t n)
+{
+    size_t count = 0;
+    size_t r;
+
+    if (n == 0)
+    {
+        return 0;
+    }
+
+    bool locked = heap_lock();
+    if (heap_listp == NULL)
+    {
+        heap_unlock(locked);
+        return 0;
+    }
+    size_t nregions = (heap_size() + region_size - 1) >> REGION_SHIFT;
+    if (nregions > MAX_REGIONS)
+    {
+        nregions = MAX_REGIONS;
+    }
+
+    for (r = 0; r < nregions; ++r)
+    {
+        if (region_live[r] == 0)
+        {
+            continue;
+        }
+
+        mm_region_stats_t cur;
+        cur.offset = r << REGION_SHIFT;
+        cur.size = region_span(r);
+        cur.live = region_live[r];
+
+        // find the slot of cur among the sorted entries
+        size_t i = count;
+        while (i > 0)
+        {
+            mm_region_stats_t *prev = &stats[i-1];
+            size_t lhs = cur.live * prev->size;
+            size_t rhs = prev->live * cur.size;
+            if (lhs > rhs || (lhs == rhs && cur.live >= prev->live))
+            {
+                break;
+            }
+            if (i < n)
+            {
+                stats[i] = *prev;
+            }
+            --i;
+        }
+        if (i < n)
+        {
+            stats[i] = cur;
+            if (count < n)
+            {
+                ++count;
+            }
+        }
+    }
+    heap_unlock(locked);
+    return count;
+}
+
+/*
+ * mm_usable_size: returns the payload capacity of the block holding ptr,
+ *                 including any slack left by alignment or by place not
+ *                 splitting off a remainder smaller than min_block_size.
+ */
+size_t mm_usable_size(void *ptr)
+{
+    if (ptr == NULL)
+    {
+        return 0;
+    }
+    return get_payload_size(payload_to_header(ptr));
+}
+
+/*
+ * mm_good_size: returns the payload size malloc(size) is guaranteed to
+ *               provide. The block found may still be slightly larger if
+ *               place cannot split it.
+ */
+size_t mm_good_size(size_t size)
+{
+    size_t asize = adjust_size(size);
+    if (size == 0 || asize == 0)
+    {
+        return 0;
+    }
+    return asize - wsize;
+}
+
+/*
+ * mm_purge_enable: starts or stops the background purge thread. While it
+ *                  runs every entry point takes heap_mutex, so the thread
+ *                  can walk the free lists safely. Returns false if the
+ *                  thread could not be started.
+ */
+bool mm_purge_enable(bool enable)
+{
+    if (enable == purge_running)
+    {
+        return true;
+    }
+
+    if (!enable)
+    {
+        pthread_mutex_lock(&heap_mutex);
+        purge_stop = true;
+        pthread_cond_signal(&purge_cond);
+        pthread_mutex_unlock(&heap_mutex);
+        pthread_join(purge_thread, NULL);
+        pthread_cond_destroy(&purge_cond);
+        purge_running = false;
+        return true;
+    }
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&purge_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if (page_size == 0)
+    {
+        page_size = (size_t)sysconf(_SC_PAGESIZE);
+    }
+    if (purge_decay_ns == 0)
+    {
+        purge_decay_ns = purge_default_decay_ms * 1000000;
+    }
+    purge_stop = false;
+    purge_running = true;
+    if (pthread_create(&purge_thread, NULL, purge_main, NULL) != 0)
+    {
+        purge_running = false;
+        pthread_cond_destroy(&purge_cond);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * mm_purge_pause: stops (or resumes) purging without ending the thread.
+ */
+void mm_purge_pause(bool paused)
+{
+    bool locked = heap_lock();
+    purge_paused = paused;
+    heap_unlock(locked);
+}
+
+/*
+ * mm_purge_set_decay: sets how long a free block may stay untouched before
+ *                     all of its pages are returned.
+ */
+void mm_purge_set_decay(uint64_t decay_ms)
+{
+    bool locked = heap_lock();
+    purge_decay_ns = max(decay_ms, 1) * 1000000;
+    if (locked)
+    {
+        pthread_cond_signal(&purge_cond);
+    }
+    heap_unlock(locked);
+}
+
+/*
+ * mm_purge_now: returns the pages of every free block right away, whether
+ *               or not the thread is running. Returns the bytes released.
+ */
+size_t mm_purge_now(void)
+{
+    bool locked = heap_lock();
+    if (page_size == 0)
+    {
+        page_size = (size_t)sysconf(_SC_PAGESIZE);
+    }
+    size_t bytes = purge_heap(true);
+    heap_unlock(locked);
+    return bytes;
+}
+
+/*
+ * mm_latency_enable: turns latency recording on or off. Histograms keep
+ *                    their contents until mm_latency_reset.
+ */
+void mm_latency_enable(bool enable)
+{
+    latency_on = enable;
+}
+
+/*
+ * mm_latency_read: copies the histogram of one series into hist. Returns
+ *                  false if series is out of range.
+ */
+bool mm_latency_read(int series, mm_lat_hist_t *hist)
+{
+    if (series < 0 || series >= MM_LAT_NSERIES)
+    {
+        return false;
+    }
+    bool locked = heap_lock();
+    *hist = latency[series];
+    heap_unlock(locked);
+    return true;
+}
+
+void mm_latency_reset(void)
+{
+    bool locked = heap_lock();
+    int i, j;
+    for (i = 0; i < MM_LAT_NSERIES; ++i)
+    {
+        latency[i].count = 0;
+        latency[i].total = 0;
+        latency[i].min = 0;
+        latency[i].max = 0;
+        for (j = 0; j < MM_LAT_BUCKETS; ++j)
+        {
+            latency[i].buckets[j] = 0;
+        }
+    }
+    heap_unlock(locked);
+}
+
+/*
+ * mm_latency_bucket_min: returns the smallest latency counted in bucket.
+ *                        Buckets below MM_LAT_SUB hold one value each; after
+ *                        that every power of two is split into MM_LAT_SUB
+ *                        equal sub-buckets. Returns false if bucket is out
+ *                        of range.
+ */
+bool mm_latency_bucket_min(int bucket, uint64_t *min)
+{
+    if (bucket < 0 || bucket >= MM_LAT_BUCKETS)
+    {
+        return false;
+    }
+    if (bucket < MM_LAT_SUB)
+    {
+        *min = (uint64_t)bucket;
+        return true;
+    }
+    int e = bucket / MM_LAT_SUB + 1;
+    uint64_t sub = (uint64_t)(bucket % MM_LAT_SUB);
+    *min = (MM_LAT_SUB + sub) << (e - 2);
+    return true;
+}
+
+/*
+ * mm_init_persistent: maps the heap file at path to base, reserving size
+ *                     bytes of address space for it. If the file holds a
+ *                     heap that was closed cleanly at the same base, the
+ *                     allocator carries on with it and *restored is set;
+ *                     otherwise a new heap is created in the file. Returns
+ *                     false on error, including a saved heap that does not
+ *                     fit in size bytes, which is left untouched.
+ */
+bool mm_init_persistent(const char *path, void *base, size_t size, bool *restored)
+{
+    struct stat st;
+    bool ok = false;
+
+    *restored = false;
+    persist_hsize = round_up(sizeof(persist_header_t), (size_t)sysconf(_SC_PAGESIZE));
+    if (persist != NULL || size < persist_hsize)
+    {
+        return false;
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (fd < 0)
+    {
+        return false;
+    }
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return false;
+    }
+
+#ifdef MAP_FIXED_NOREPLACE
+    int flags = MAP_SHARED | MAP_FIXED_NOREPLACE;
+#else
+    int flags = MAP_SHARED;
+#endif
+    void *map = mmap(base, size, PROT_READ | PROT_WRITE, flags, fd, 0);
+    if (map != base)
+    {
+        // the base was taken; pointers in the file would be meaningless
+        if (map != MAP_FAILED)
+        {
+            munmap(map, size);
+        }
+        close(fd);
+        return false;
+    }
+
+    bool locked = heap_lock();
+    if ((size_t)st.st_size < persist_hsize
+        && ftruncate(fd, (off_t)persist_hsize) != 0)
+    {
+        munmap(map, size);
+        close(fd);
+        heap_unlock(locked);
+        return false;
+    }
+    persist_header_t *hdr = (persist_header_t *)map;
+    bool saved = (size_t)st.st_size >= persist_hsize
+        && hdr->magic == PERSIST_MAGIC
+        && hdr->base == (word_t)base
+        && hdr->clean
+        && persist_hsize + hdr->brk <= (size_t)st.st_size;
+    if (saved && persist_hsize + hdr->brk > size)
+    {
+        // the saved heap is larger than the reservation asked for
+        munmap(map, size);
+        close(fd);
+        heap_unlock(locked);
+        return false;
+    }
+    persist = hdr;
+    persist_fd = fd;
+    persist_size = size;
+
+    if (saved)
+    {
+        int i;
+        heap_listp = persist->heap_listp;
+        blockpointer = persist->blockpointer;
+        for (i = 0; i < MM_NUM_CLASSES; ++i)
+        {
+            begin[i] = persist->begin[i];
+            end[i] = persist->end[i];
+        }
+        persist_rebuild();
+        *restored = true;
+        ok = true;
+    }
+    else
+    {
+        persist->magic = PERSIST_MAGIC;
+        persist->base = (word_t)base;
+        ok = do_init();
+    }
+    // the saved globals go stale with the first change
+    persist->clean = 0;
+
+    static bool registered = false;
+    if (!registered)
+    {
+        atexit(persist_exit);
+        registered = true;
     }
+    heap_unlock(locked);
+    return ok;
+}
 
-    // Copy the old data
-    copysize = get_payload_size(block); // gets size of old payload
-    if(size < copysize)
+/*
+ * mm_persist_set_root: records the application's root object in the file
+ *                      header, so a restored heap can find its data again.
+ */
+void mm_persist_set_root(void *root)
+{
+    bool locked = heap_lock();
+    if (persist != NULL)
     {
-        copysize = size;
+        persist->root = root;
     }
-    memcpy(newptr, oldptr, copysize);
+    heap_unlock(locked);
+}
 
-    // Free the old block
-    free(oldptr);
+/*
+ * mm_persist_root: returns the root object saved with the heap, or NULL if
+ *                  there is none or the heap is not persistent.
+ */
+void *mm_persist_root(void)
+{
+    bool locked = heap_lock();
+    void *root = (persist != NULL) ? persist->root : NULL;
+    heap_unlock(locked);
+    return root;
+}
 
-    return newptr;
+/*
+ * mm_persist_close: saves the allocator globals into the file header,
+ *                   flushes the heap to the file and unmaps it. The heap
+ *                   can no longer be used until the next mm_init.
+ */
+void mm_persist_close(void)
+{
+    bool locked = heap_lock();
+    if (persist != NULL)
+    {
+        persist_save();
+        msync(persist, persist_hsize + persist->brk, MS_SYNC);
+        munmap(persist, persist_size);
+        close(persist_fd);
+        persist = NULL;
+        persist_fd = -1;
+        heap_listp = NULL;
+        blockpointer = NULL;
+    }
+    heap_unlock(locked);
 }
+
 /*
- * calloc
- * This function is not tested by mdriver
+ * mm_snapshot: walks the heap from heap_listp and writes it to fd in the
+ *              format described in mm_ext.h. Consecutive blocks with the
+ *              same size, state and list are merged into one record.
+ *              Returns false if a write fails.
  */
-void *calloc(size_t nmemb, size_t size)
+bool mm_snapshot(int fd)
 {
-    void *bp;
-    size_t asize = nmemb * size;
+    mm_snap_record_t buf[256];
+    mm_snap_header_t hdr;
+    size_t n = 0;
+    bool ok;
+
+    bool locked = heap_lock();
+    hdr.magic = MM_SNAP_MAGIC;
+    hdr.heap_size = (heap_listp == NULL) ? 0 : heap_size();
+    ok = write_all(fd, &hdr, sizeof(hdr));
+
+    block_t *block = heap_listp;
+    while (ok && block != NULL && get_size(block) > 0)
+    {
+        size_t size = get_size(block);
+        bool alloc = get_alloc(block);
+        int bin = alloc ? -1 : blockindex(size);
+        mm_snap_record_t *last = (n > 0) ? &buf[n-1] : NULL;
 
-    if (asize/nmemb != size)
-    // Multiplication overflowed
-    return NULL;
-    
-    bp = malloc(asize);
-    if (bp == NULL)
+        if (last != NULL && last->size == size && last->alloc == alloc
+            && last->bin == bin && last->count < UINT32_MAX)
+        {
+            last->count++;
+        }
+        else
+        {
+            if (n == sizeof(buf) / sizeof(buf[0]))
+            {
+                ok = write_all(fd, buf, n * sizeof(buf[0]));
+                n = 0;
+            }
+            buf[n].offset = heap_offset(block);
+            buf[n].size = size;
+            buf[n].count = 1;
+            buf[n].alloc = alloc;
+            buf[n].bin = (int8_t)bin;
+            buf[n].pad = 0;
+            ++n;
+        }
+        block = find_next(block);
+    }
+    if (ok && n > 0)
     {
-        return NULL;
+        ok = write_all(fd, buf, n * sizeof(buf[0]));
     }
-    // Initialize all bits to 0
-    memset(bp, 0, asize);
-
-    return bp;
+    heap_unlock(locked);
+    return ok;
 }
 
 
@@ -344,7 +1133,7 @@ static block_t *extend_heap(size_t size)
 
     // Allocate an even number of words to maintain alignment
     size = round_up(size, dsize);
-    if ((bp = mem_sbrk(size)) == (void *)-1)
+    if ((bp = heap_sbrk(size)) == (void *)-1)
     {
         return NULL;
     }
@@ -407,7 +1196,8 @@ static block_t *coalesce(block_t * block)
 
     else if (prev_alloc && !next_alloc)        // Case 2
     {
-        
+        // block_next stays on top, so its purged pages stay purged
+        word_t purged = purged_pages(block_next);
         size += get_size(block_next);
         //first remove the next free block in the free list
         remove_free_list(block_next);
@@ -419,6 +1209,7 @@ static block_t *coalesce(block_t * block)
         write_footer(block, size, false);
         // then add the new combined free block to the free list
         add_free_list(block);
+        carry_purged(block, purged);
     }
 
     else if (!prev_alloc && next_alloc)        // Case 3
@@ -446,6 +1237,7 @@ static block_t *coalesce(block_t * block)
     else                                     // Case 4
     {
         block_t *block_prev = find_prev(block);
+        word_t purged = purged_pages(block_next);
         size += get_size(block_next) + get_size(block_prev);
         // first remove both the former and latter free block in the free
         // list
@@ -461,6 +1253,7 @@ static block_t *coalesce(block_t * block)
         block = block_prev;
         // add the noew combined free block into the free list
         add_free_list(block);
+        carry_purged(block, purged);
     }
     return block;
 }
@@ -480,6 +1273,7 @@ static void place(block_t *block, size_t asize)
      dbg_printf("csize is %lu \n", (word_t) csize);
      dbg_printf("min size is %lu \n", (word_t) min_block_size);
     // remove the free block which is being used
+    word_t purged = purged_pages(block);
     remove_free_list(block);
 
     if ((csize - asize) >= min_block_size)
@@ -487,6 +1281,7 @@ static void place(block_t *block, size_t asize)
         block_t *block_next;
         bool boolprev = get_prev_alloc(block);
         write_header(block, asize, boolprev,true);
+        account_region(block, asize, true);
         //write_footer(block, asize, true);
         block_next = find_next(block);
         if(block == blockpointer)
@@ -496,14 +1291,17 @@ static void place(block_t *block, size_t asize)
         
         write_header(block_next, csize-asize, true,false);
         write_footer(block_next, csize-asize, false);
-        // add the free block which is the newly created
+        // add the free block which is the newly created; it keeps the
+        // top of the old block and so its purged pages
         add_free_list(block_next);
+        carry_purged(block_next, purged);
     }
 
     else
     { 
          bool boolprev = get_prev_alloc(block);
         write_header(block, csize, boolprev,true);
+        account_region(block, csize, true);
        // write_footer(block, csize, true);
      
        if(block!= blockpointer)
@@ -518,14 +1316,15 @@ static void place(block_t *block, size_t asize)
 }
 
 /*
- * find_fit: in the free list, looks for the fit size block to return
+ * find_fit: in the free list, looks for the fit size block to return,
+ *           starting from class index, which must be blockindex(asize)
  */
-static block_t *find_fit(size_t asize)
+static block_t *find_fit(size_t asize, int index)
 {
     block_t *block;
     int i;
 
-for(i = blockindex(asize); i<=18; ++i){
+for(i = index; i<MM_NUM_CLASSES; ++i){
 
     if (begin[i]==NULL)
     {
@@ -561,6 +1360,20 @@ static size_t max(size_t x, size_t y)
 }
 
 
+/*
+ * adjust_size: returns the block size for a payload of size bytes, adding
+ *              the header and meeting the alignment and minimum size.
+ *              Returns 0 if that would not fit in a size_t.
+ */
+static size_t adjust_size(size_t size)
+{
+    if (size > SIZE_MAX - wsize - dsize)
+    {
+        return 0;
+    }
+    return max(round_up(size+wsize, dsize), min_block_size);
+}
+
 /*
  * round_up: Rounds size up to next multiple of n
  */
@@ -727,7 +1540,7 @@ bool mm_checkheap(int lineno)
 { 
 
     printf("free list condition as follw:\n");
-    for(int i=0; i<19;++i)
+    for(int i=0; i<MM_NUM_CLASSES;++i)
     {
         block_t *tmp = begin[i];
         printf("free list No.%d begin pointer is : %lu\n", i,(word_t)tmp);
@@ -777,7 +1590,16 @@ static bool aligned(const void *p) {
 
 static void add_free_list(block_t* block) {
 
-    int i = blockindex(get_size(block));
+    size_t size = get_size(block);
+    int i = blockindex(size);
+
+    // large blocks remember when they were freed, 0 if nobody is watching
+    if (size >= purge_min_size)
+    {
+        word_t *meta = purge_meta(block);
+        meta[0] = purge_running ? now_ns() : 0;
+        meta[1] = 0;
+    }
 
 if (begin[i]==NULL && end[i] == NULL)
     {
@@ -831,12 +1653,418 @@ else
 
 }
 
+/*
+ * blockindex: returns the segregated list for a block of size bytes:
+ *             list 0 holds sizes up to 64, list i sizes in
+ *             (2^(i+5), 2^(i+6)], and the last list everything larger.
+ *             It is mm_size_class from mm_ext.h, so mm_malloc_fixed
+ *             always picks the same list.
+ */
 static int blockindex(size_t size){
-    int i =0;
-    unsigned int comp = 64;
-    while(i<18 && comp < size){
-        ++i;
-        comp= comp<< 1;
-    }
-return i;
-}
\ No newline at end of file
+    return mm_size_class(size);
+}
+
+/*
+ * heap_offset: returns the distance of p from the start of the heap, which
+ *              is the prologue footer one word before heap_listp.
+ */
+static size_t heap_offset(const void *p)
+{
+    return (size_t)((const char *)p - ((char *)heap_listp - wsize));
+}
+
+/*
+ * heap_size: returns the number of bytes in the heap, up to and including
+ *            the epilogue header.
+ */
+static size_t heap_size(void)
+{
+    if (blockpointer == NULL)
+    {
+        return 2*wsize;
+    }
+    return heap_offset(find_next(blockpointer)) + wsize;
+}
+
+/*
+ * region_span: returns how many bytes of the heap fall in region r; only
+ *              the last region can be shorter than region_size.
+ */
+static size_t region_span(size_t r)
+{
+    size_t start = r << REGION_SHIFT;
+    size_t hsize = heap_size();
+
+    if (start >= hsize)
+    {
+        return 0;
+    }
+    return (hsize - start < region_size) ? hsize - start : region_size;
+}
+
+/*
+ * account_region: adds (alloc) or removes (!alloc) the size bytes of block
+ *                 to the live counts of every region the block overlaps.
+ *                 Blocks past the last tracked region are not counted.
+ */
+static void account_region(block_t *block, size_t size, bool alloc)
+{
+    size_t off = heap_offset(block);
+    size_t stop = off + size;
+
+    while (off < stop)
+    {
+        size_t r = off >> REGION_SHIFT;
+        if (r >= MAX_REGIONS)
+        {
+            break;
+        }
+        size_t rend = (r + 1) << REGION_SHIFT;
+        size_t n = ((stop < rend) ? stop : rend) - off;
+        if (alloc)
+        {
+            region_live[r] += n;
+        }
+        else
+        {
+            region_live[r] -= n;
+        }
+        off += n;
+    }
+}
+
+/*
+ * heap_lock: takes heap_mutex if the purge thread is running; returns
+ *            whether it did, to be handed to heap_unlock.
+ */
+static bool heap_lock(void)
+{
+    if (!purge_running)
+    {
+        return false;
+    }
+    pthread_mutex_lock(&heap_mutex);
+    return true;
+}
+
+static void heap_unlock(bool locked)
+{
+    if (locked)
+    {
+        pthread_mutex_unlock(&heap_mutex);
+    }
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * purge_meta: returns the two words after prev and next in a large free
+ *             block: the time it was freed and how many pages are purged.
+ */
+static word_t *purge_meta(block_t *block)
+{
+    return (word_t *)(block->payload + dsize);
+}
+
+/*
+ * purge_pages: returns how many whole pages of a large free block lie
+ *              between its purge metadata and its footer, and sets *hi to
+ *              the end of the last of them.
+ */
+static size_t purge_pages(block_t *block, size_t *hi)
+{
+    size_t lo = round_up((size_t)(purge_meta(block) + 2), page_size);
+
+    *hi = ((size_t)find_next(block) - wsize) / page_size * page_size;
+    return (*hi > lo) ? (*hi - lo) / page_size : 0;
+}
+
+/*
+ * purged_pages: returns how many pages of a free block have already been
+ *               purged, 0 for blocks too small to track it.
+ */
+static word_t purged_pages(block_t *block)
+{
+    if (page_size == 0 || get_size(block) < purge_min_size)
+    {
+        return 0;
+    }
+    return purge_meta(block)[1];
+}
+
+/*
+ * carry_purged: after add_free_list, restores the purged page count of a
+ *               block that kept the top of a block purged earlier. Pages
+ *               are purged from the top down, so the count still holds,
+ *               capped at the pages the block now has.
+ */
+static void carry_purged(block_t *block, word_t purged)
+{
+    if (purged == 0 || get_size(block) < purge_min_size)
+    {
+        return;
+    }
+    size_t hi;
+    size_t npages = purge_pages(block, &hi);
+    purge_meta(block)[1] = (purged < npages) ? purged : npages;
+}
+
+/*
+ * purge_block: returns pages of a large free block to the system. The pages
+ *              between the purge metadata and the footer are released from
+ *              the top down, and the share released follows a smootherstep
+ *              curve of the block's age over the decay interval, so blocks
+ *              that are reused soon lose little. force releases them all.
+ *              Returns the number of bytes released.
+ */
+static size_t purge_block(block_t *block, uint64_t now, bool force)
+{
+    word_t *meta = purge_meta(block);
+    size_t hi;
+    size_t npages = purge_pages(block, &hi);
+
+    if (npages == 0)
+    {
+        return 0;
+    }
+    size_t target = npages;
+
+    if (!force)
+    {
+        // a block freed before the thread started starts aging now
+        if (meta[0] == 0 || meta[0] > now)
+        {
+            meta[0] = now;
+            return 0;
+        }
+        double x = (double)(now - meta[0]) / (double)purge_decay_ns;
+        if (x < 1.0)
+        {
+            double smooth = x * x * x * (x * (x * 6 - 15) + 10);
+            target = (size_t)(smooth * (double)npages);
+        }
+    }
+
+    if (target <= meta[1])
+    {
+        return 0;
+    }
+    size_t bytes = (target - meta[1]) * page_size;
+    madvise((void *)(hi - target * page_size), bytes, MADV_DONTNEED);
+    meta[1] = target;
+    return bytes;
+}
+
+/*
+ * purge_heap: runs purge_block over every free block large enough to have
+ *             purge metadata. Returns the number of bytes released.
+ */
+static size_t purge_heap(bool force)
+{
+    size_t bytes = 0;
+    uint64_t now = now_ns();
+    int i;
+
+    if (heap_listp == NULL)
+    {
+        return 0;
+    }
+    for (i = blockindex(purge_min_size); i < MM_NUM_CLASSES; ++i)
+    {
+        block_t *block;
+        for (block = begin[i]; block != NULL; block = block->next)
+        {
+            if (get_size(block) >= purge_min_size)
+            {
+                bytes += purge_block(block, now, force);
+            }
+        }
+    }
+    return bytes;
+}
+
+/*
+ * purge_main: body of the purge thread. Wakes PURGE_STEPS times per decay
+ *             interval and ages the free blocks under heap_mutex.
+ */
+static void *purge_main(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&heap_mutex);
+    while (!purge_stop)
+    {
+        if (!purge_paused)
+        {
+            purge_heap(false);
+        }
+
+        uint64_t wake = now_ns() + purge_decay_ns / PURGE_STEPS;
+        struct timespec ts;
+        ts.tv_sec = (time_t)(wake / 1000000000);
+        ts.tv_nsec = (long)(wake % 1000000000);
+        pthread_cond_timedwait(&purge_cond, &heap_mutex, &ts);
+    }
+    pthread_mutex_unlock(&heap_mutex);
+    return NULL;
+}
+
+/*
+ * cycles: reads the time stamp counter where there is one, and falls back
+ *         to nanoseconds elsewhere.
+ */
+static uint64_t cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return now_ns();
+#endif
+}
+
+/*
+ * latency_bucket: log-linear bucket of t, the inverse of
+ *                 mm_latency_bucket_min (which assumes MM_LAT_SUB == 4).
+ */
+static int latency_bucket(uint64_t t)
+{
+    if (t < MM_LAT_SUB)
+    {
+        return (int)t;
+    }
+    int e = 63 - __builtin_clzll(t);
+    int sub = (int)(t >> (e - 2)) & (MM_LAT_SUB - 1);
+    return (e - 1) * MM_LAT_SUB + sub;
+}
+
+static void record_latency(int series, uint64_t start)
+{
+    uint64_t t = cycles() - start;
+    mm_lat_hist_t *hist = &latency[series];
+
+    if (hist->count == 0 || t < hist->min)
+    {
+        hist->min = t;
+    }
+    if (t > hist->max)
+    {
+        hist->max = t;
+    }
+    hist->count++;
+    hist->total += t;
+    hist->buckets[latency_bucket(t)]++;
+}
+
+/*
+ * heap_sbrk: extends the heap by size bytes and returns the old break, or
+ *            (void *)-1 on error. A persistent heap grows the file to match.
+ */
+static void *heap_sbrk(size_t size)
+{
+    if (persist == NULL)
+    {
+        return mem_sbrk((intptr_t)size);
+    }
+
+    size_t newbrk = persist->brk + size;
+    if (persist_hsize + newbrk > persist_size
+        || ftruncate(persist_fd, (off_t)(persist_hsize + newbrk)) != 0)
+    {
+        return (void *)-1;
+    }
+    void *bp = (char *)persist + persist_hsize + persist->brk;
+    persist->brk = newbrk;
+    return bp;
+}
+
+/*
+ * persist_save: copies the allocator globals into the persistent heap
+ *               header and marks it clean. The caller holds heap_mutex.
+ */
+static void persist_save(void)
+{
+    int i;
+
+    if (persist == NULL)
+    {
+        return;
+    }
+    persist->heap_listp = heap_listp;
+    persist->blockpointer = blockpointer;
+    for (i = 0; i < MM_NUM_CLASSES; ++i)
+    {
+        persist->begin[i] = begin[i];
+        persist->end[i] = end[i];
+    }
+    persist->clean = 1;
+}
+
+/*
+ * persist_exit: saves the persistent heap at exit, holding heap_mutex so
+ *               the purge thread is not walking the lists meanwhile.
+ */
+static void persist_exit(void)
+{
+    bool locked = heap_lock();
+    persist_save();
+    heap_unlock(locked);
+}
+
+/*
+ * persist_rebuild: recomputes the state that is not saved in the file
+ *                  after reopening a persistent heap: the region live
+ *                  counts, and the purge timestamps, which belong to the
+ *                  old process's clock.
+ */
+static void persist_rebuild(void)
+{
+    block_t *block;
+    int i;
+
+    for (i = 0; i < MAX_REGIONS; ++i)
+    {
+        region_live[i] = 0;
+    }
+    for (block = heap_listp; get_size(block) > 0; block = find_next(block))
+    {
+        size_t size = get_size(block);
+        if (get_alloc(block))
+        {
+            account_region(block, size, true);
+        }
+        else if (size >= purge_min_size)
+        {
+            word_t *meta = purge_meta(block);
+            meta[0] = 0;
+            meta[1] = 0;
+        }
+    }
+}
+
+/*
+ * write_all: writes n bytes of buf to fd, retrying short writes.
+ */
+static bool write_all(int fd, const void *buf, size_t n)
+{
+    const char *p = buf;
+
+    while (n > 0)
+    {
+        ssize_t w = write(fd, p, n);
+        if (w < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (w <= 0)
+        {
+            return false;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    return true;
+}
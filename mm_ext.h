@@ -0,0 +1,198 @@
+/*
+ * mm_ext.h
+ * Extensions to the mm.c allocator beyond the malloc/free/realloc/calloc
+ * interface declared in mm.h.
+ */
+#ifndef MM_EXT_H
+#define MM_EXT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Relocation hints. The heap is split into fixed-size regions and the
+ * allocator keeps a count of live (allocated) bytes in each of them.
+ */
+typedef struct
+{
+    size_t offset;  // start of the region, relative to the heap base
+    size_t size;    // bytes of heap covered by the region
+    size_t live;    // bytes held by allocated blocks in the region
+} mm_region_stats_t;
+
+/*
+ * mm_should_relocate: returns true when the block holding ptr sits in a
+ *                     sparsely used region and a fresh allocation of the
+ *                     same size would land in a denser one, i.e. copying
+ *                     the object and freeing ptr would help compaction.
+ */
+bool mm_should_relocate(void *ptr);
+
+/*
+ * mm_region_stats: fills stats with up to n non-empty regions, least
+ *                  utilized first, and returns how many were written.
+ */
+size_t mm_region_stats(mm_region_stats_t *stats, size_t n);
+
+/*
+ * mm_usable_size: returns how many bytes the caller may use at ptr, which
+ *                 can exceed the size originally requested.
+ */
+size_t mm_usable_size(void *ptr);
+
+/*
+ * mm_good_size: returns the payload size a request of size bytes will be
+ *               rounded up to, so callers can ask for the whole block.
+ */
+size_t mm_good_size(size_t size);
+
+/*
+ * Background purge. A thread returns the pages of free blocks that have
+ * been left untouched, releasing more of each block the longer it stays
+ * free until all of it is gone after one decay interval. mm.c must be
+ * linked with -pthread.
+ */
+bool mm_purge_enable(bool enable);
+void mm_purge_pause(bool paused);
+void mm_purge_set_decay(uint64_t decay_ms);
+size_t mm_purge_now(void);
+
+/*
+ * Latency histograms, one series per call and the path it took. Times are
+ * in TSC cycles on x86 and nanoseconds elsewhere. Recording is off until
+ * mm_latency_enable(true).
+ */
+enum
+{
+    MM_LAT_MALLOC_FIT,       // malloc served from a free list
+    MM_LAT_MALLOC_EXTEND,    // malloc had to extend the heap
+    MM_LAT_FREE,
+    MM_LAT_REALLOC_INPLACE,  // realloc kept the block
+    MM_LAT_REALLOC_COPY,     // realloc moved the data (or was malloc/free)
+    MM_LAT_CALLOC_FIT,
+    MM_LAT_CALLOC_EXTEND,
+    MM_LAT_NSERIES
+};
+
+#define MM_LAT_SUB 4         // sub-buckets per power of two
+#define MM_LAT_BUCKETS ((64 - 1) * MM_LAT_SUB)   // 252: the last covers up to 2^64-1
+
+typedef struct
+{
+    uint64_t count;
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[MM_LAT_BUCKETS];
+} mm_lat_hist_t;
+
+void mm_latency_enable(bool enable);
+bool mm_latency_read(int series, mm_lat_hist_t *hist);
+void mm_latency_reset(void);
+bool mm_latency_bucket_min(int bucket, uint64_t *min);
+
+/*
+ * Persistent heap. The heap lives in a file mapped at a fixed base, with
+ * the allocator globals saved in a header page, so a restarted process can
+ * map it again and keep its allocations. The globals are saved by
+ * mm_persist_close or at exit; a file that was not closed cleanly is
+ * started over. *restored tells the caller whether it got the old heap
+ * back or must rebuild its data; mm_persist_root then returns the object
+ * last passed to mm_persist_set_root. Calling mm_init on a persistent heap
+ * starts it over and discards the file's contents.
+ */
+bool mm_init_persistent(const char *path, void *base, size_t size, bool *restored);
+void mm_persist_set_root(void *root);
+void *mm_persist_root(void);
+void mm_persist_close(void);
+
+/*
+ * Constant-size fast path. For a compile-time constant size,
+ * mm_malloc_fixed(size) folds the block size and size class away and calls
+ * mm_malloc_class, which pops the head of the next larger class's list,
+ * where every block is big enough, and only searches with find_fit or
+ * grows the heap when that list is empty. Other sizes go to malloc. mm.c
+ * checks the constants below against its own layout and uses
+ * mm_size_class as its blockindex.
+ */
+#define MM_WSIZE 8
+#define MM_DSIZE 16
+#define MM_MIN_BLOCK_SIZE 32
+#define MM_NUM_CLASSES 19
+
+void *mm_malloc_class(size_t asize, int index);
+
+/* mm_block_size: adjust_size from mm.c, 0 if the block size overflows */
+static inline __attribute__((always_inline)) size_t mm_block_size(size_t size)
+{
+    if (size > SIZE_MAX - MM_WSIZE - MM_DSIZE)
+    {
+        return 0;
+    }
+    size_t asize = (size + MM_WSIZE + MM_DSIZE - 1) / MM_DSIZE * MM_DSIZE;
+    return (asize > MM_MIN_BLOCK_SIZE) ? asize : MM_MIN_BLOCK_SIZE;
+}
+
+static inline __attribute__((always_inline)) int mm_size_class(size_t asize)
+{
+    if (asize <= 64)
+    {
+        return 0;
+    }
+    int i = 58 - __builtin_clzl(asize - 1);
+    return (i < MM_NUM_CLASSES - 1) ? i : MM_NUM_CLASSES - 1;
+}
+
+static inline __attribute__((always_inline)) void *mm_malloc_const(size_t size)
+{
+    if (size == 0)
+    {
+        return NULL;
+    }
+    size_t asize = mm_block_size(size);
+    if (asize == 0)
+    {
+        return NULL;
+    }
+    return mm_malloc_class(asize, mm_size_class(asize));
+}
+
+/* the driver build renames malloc to mm_malloc */
+#ifdef DRIVER
+void *mm_malloc(size_t size);
+#define mm_malloc_fixed(size) \
+    (__builtin_constant_p(size) ? mm_malloc_const(size) : mm_malloc(size))
+#else
+void *malloc(size_t size);
+#define mm_malloc_fixed(size) \
+    (__builtin_constant_p(size) ? mm_malloc_const(size) : malloc(size))
+#endif
+
+/*
+ * Heap snapshots. mm_snapshot(fd) streams an mm_snap_header_t followed by
+ * mm_snap_record_t records in heap order until end of file; mmsnap reads
+ * them back. Runs of consecutive blocks with the same size and state share
+ * one record. Free blocks are always coalesced, so each hole is one record.
+ */
+#define MM_SNAP_MAGIC 0x70616e736d6d0001ULL   // "mmsnap" plus a version
+
+typedef struct
+{
+    uint64_t magic;
+    uint64_t heap_size;   // bytes from the prologue to the epilogue
+} mm_snap_header_t;
+
+typedef struct
+{
+    uint64_t offset;      // first block of the run, from the heap start
+    uint64_t size;        // size of each block, header included
+    uint32_t count;       // blocks in the run
+    uint8_t alloc;
+    int8_t bin;           // free list of a free block, -1 if allocated
+    uint16_t pad;
+} mm_snap_record_t;
+
+bool mm_snapshot(int fd);
+
+#endif /* MM_EXT_H */
@@ -0,0 +1,638 @@
+/*
+ * mmbench.c
+ * Microbenchmarks for the hot paths of mm.c.
+ *
+ * Build it like the driver, against the same memlib:
+ *     gcc -O2 -DDRIVER -o mmbench mmbench.c mm.c memlib.c -pthread
+ *
+ * Every workload runs on a fresh heap and is split into phases that each
+ * repeat a single kind of operation, so the counters read around a phase
+ * divide cleanly into a per-operation cost. Cycles, instructions, cache
+ * misses and dTLB load misses come from perf_event_open and are printed as
+ * null where the kernel does not allow them. Each phase prints one JSON
+ * object per line:
+ *
+ *     {"workload":"churn","phase":"malloc","ops":...,"ns":...,
+ *      "cycles":...,"instructions":...,"cache_misses":...,
+ *      "dtlb_misses":...,"peak_heap":...,"utilization":...}
+ *
+ * where the counter fields are per operation, peak_heap is the heap size
+ * in bytes so far and utilization is peak live payload over peak_heap.
+ * At scale 1 every workload stays well under the driver's 100MB heap; a
+ * workload that still runs out of memory prints
+ *
+ *     {"workload":"random","error":"out of memory"}
+ *
+ * and the remaining workloads go on.
+ *
+ * Usage: mmbench [-n scale] [-s seed] [workload ...]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <time.h>
+#include <setjmp.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "mm_ext.h"
+
+#define NCOUNTERS 4
+
+typedef struct
+{
+    uint64_t ns;
+    uint64_t value[NCOUNTERS];
+} sample_t;
+
+/* perf events, in the order they are reported */
+static const char *counter_names[NCOUNTERS] =
+{
+    "cycles", "instructions", "cache_misses", "dtlb_misses"
+};
+static int counter_fd[NCOUNTERS] = { -1, -1, -1, -1 };
+static int counter_slot[NCOUNTERS];   // position in the group read, or -1
+static int ngroup = 0;
+
+/* bookkeeping for the current workload */
+static const char *workload;
+static size_t live_bytes;
+static size_t peak_live;
+static size_t scale = 1;
+static jmp_buf bench_abort;   // where an allocation failure unwinds to
+
+static char **slots;
+static size_t *slot_size;
+static size_t *order;         // scratch permutation of the slots
+
+/*
+ * rng: xorshift64, so runs with the same seed replay the same requests
+ *      whatever libc is underneath.
+ */
+static uint64_t rng_state = 88172645463325252ULL;
+
+static uint64_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+/*
+ * open_counter: adds one hardware event to the group led by counter_fd[0].
+ */
+static void open_counter(int i, uint32_t type, uint64_t config)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+
+    int leader = (i == 0) ? -1 : counter_fd[0];
+    if (i != 0 && leader < 0)
+    {
+        counter_slot[i] = -1;
+        return;
+    }
+    counter_fd[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+    counter_slot[i] = (counter_fd[i] < 0) ? -1 : ngroup++;
+}
+
+static void open_counters(void)
+{
+    open_counter(0, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    open_counter(1, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    open_counter(2, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    open_counter(3, PERF_TYPE_HW_CACHE,
+                 PERF_COUNT_HW_CACHE_DTLB
+                 | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                 | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+}
+
+static void read_sample(sample_t *s)
+{
+    uint64_t buf[1 + NCOUNTERS];
+    struct timespec ts;
+    int i;
+
+    memset(s, 0, sizeof(*s));
+    if (counter_fd[0] >= 0
+        && read(counter_fd[0], buf, sizeof(buf)) >= (ssize_t)sizeof(uint64_t))
+    {
+        for (i = 0; i < NCOUNTERS; ++i)
+        {
+            if (counter_slot[i] >= 0 && (uint64_t)counter_slot[i] < buf[0])
+            {
+                s->value[i] = buf[1 + counter_slot[i]];
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    s->ns = (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * report: prints one phase as a JSON line, with every cost per operation.
+ */
+static void report(const char *phase, size_t ops, sample_t *before, sample_t *after)
+{
+    size_t heap = mem_heapsize();
+    int i;
+
+    if (ops == 0)
+    {
+        ops = 1;
+    }
+    printf("{\"workload\":\"%s\",\"phase\":\"%s\",\"ops\":%zu,\"ns\":%.2f",
+           workload, phase, ops, (double)(after->ns - before->ns) / ops);
+    for (i = 0; i < NCOUNTERS; ++i)
+    {
+        if (counter_slot[i] < 0)
+        {
+            printf(",\"%s\":null", counter_names[i]);
+        }
+        else
+        {
+            printf(",\"%s\":%.2f", counter_names[i],
+                   (double)(after->value[i] - before->value[i]) / ops);
+        }
+    }
+    printf(",\"peak_heap\":%zu,\"utilization\":%.4f}\n",
+           heap, heap ? (double)peak_live / heap : 0.0);
+    fflush(stdout);
+}
+
+/*
+ * Allocation wrappers that keep track of live payload bytes.
+ */
+static void bench_malloc(size_t i, size_t size)
+{
+    slots[i] = mm_malloc(size);
+    if (slots[i] == NULL)
+    {
+        longjmp(bench_abort, 1);
+    }
+    slot_size[i] = size;
+    live_bytes += size;
+    if (live_bytes > peak_live)
+    {
+        peak_live = live_bytes;
+    }
+}
+
+static void bench_free(size_t i)
+{
+    mm_free(slots[i]);
+    live_bytes -= slot_size[i];
+    slots[i] = NULL;
+    slot_size[i] = 0;
+}
+
+static void bench_realloc(size_t i, size_t size)
+{
+    char *p = mm_realloc(slots[i], size);
+    if (p == NULL)
+    {
+        longjmp(bench_abort, 1);
+    }
+    slots[i] = p;
+    live_bytes += size - slot_size[i];
+    slot_size[i] = size;
+    if (live_bytes > peak_live)
+    {
+        peak_live = live_bytes;
+    }
+}
+
+/* random sizes, mostly small with a tail up to 8KB, like real programs */
+static size_t random_size(void)
+{
+    int shift = (int)(rng() % 10);
+    return (size_t)(rng() % ((size_t)16 << shift)) + 1;
+}
+
+/* shuffle: fills order with a random permutation of 0..n-1 */
+static void shuffle(size_t n)
+{
+    size_t i;
+    for (i = 0; i < n; ++i)
+    {
+        order[i] = i;
+    }
+    for (i = n; i > 1; --i)
+    {
+        size_t j = (size_t)(rng() % i);
+        size_t tmp = order[i-1];
+        order[i-1] = order[j];
+        order[j] = tmp;
+    }
+}
+
+/*
+ * accumulate: adds the cost between before and after to total.
+ */
+static void accumulate(sample_t *total, sample_t *before, sample_t *after)
+{
+    int i;
+    for (i = 0; i < NCOUNTERS; ++i)
+    {
+        total->value[i] += after->value[i] - before->value[i];
+    }
+    total->ns += after->ns - before->ns;
+}
+
+/*
+ * churn: the same small size allocated and freed in bulk, over and over.
+ */
+static void bench_churn(void)
+{
+    size_t n = 50000, rounds = 20 * scale;
+    size_t r, i;
+    sample_t zero, mallocs, frees, s0, s1;
+
+    memset(&zero, 0, sizeof(zero));
+    mallocs = zero;
+    frees = zero;
+    for (r = 0; r < rounds; ++r)
+    {
+        read_sample(&s0);
+        for (i = 0; i < n; ++i)
+        {
+            bench_malloc(i, 64);
+        }
+        read_sample(&s1);
+        accumulate(&mallocs, &s0, &s1);
+
+        read_sample(&s0);
+        for (i = 0; i < n; ++i)
+        {
+            bench_free(i);
+        }
+        read_sample(&s1);
+        accumulate(&frees, &s0, &s1);
+    }
+    report("malloc", n * rounds, &zero, &mallocs);
+    report("free", n * rounds, &zero, &frees);
+}
+
+/*
+ * fixed: churn with a constant size, alternating rounds of mm_malloc and
+ *        mm_malloc_fixed so the two phases see the same heap.
+ */
+static void bench_fixed(void)
+{
+    size_t n = 50000, rounds = 20 * scale;
+    size_t r, i;
+    sample_t zero, mallocs, fixed, frees, s0, s1;
+
+    memset(&zero, 0, sizeof(zero));
+    mallocs = zero;
+    fixed = zero;
+    frees = zero;
+    for (r = 0; r < 2 * rounds; ++r)
+    {
+        read_sample(&s0);
+        if (r % 2 == 0)
+        {
+            for (i = 0; i < n; ++i)
+            {
+                bench_malloc(i, 48);
+            }
+        }
+        else
+        {
+            for (i = 0; i < n; ++i)
+            {
+                slots[i] = mm_malloc_fixed(48);
+                if (slots[i] == NULL)
+                {
+                    longjmp(bench_abort, 1);
+                }
+                slot_size[i] = 48;
+            }
+            live_bytes += n * 48;
+            peak_live = (live_bytes > peak_live) ? live_bytes : peak_live;
+        }
+        read_sample(&s1);
+        accumulate((r % 2 == 0) ? &mallocs : &fixed, &s0, &s1);
+
+        read_sample(&s0);
+        for (i = 0; i < n; ++i)
+        {
+            bench_free(i);
+        }
+        read_sample(&s1);
+        accumulate(&frees, &s0, &s1);
+    }
+    report("malloc", n * rounds, &zero, &mallocs);
+    report("malloc_fixed", n * rounds, &zero, &fixed);
+    report("free", 2 * n * rounds, &zero, &frees);
+}
+
+/*
+ * random: random sizes malloc'd into every slot, half of them freed in
+ *         random order, the holes refilled, then everything freed.
+ */
+static void bench_random(void)
+{
+    size_t n = 40000 * scale;
+    size_t i;
+    sample_t s0, s1;
+
+    read_sample(&s0);
+    for (i = 0; i < n; ++i)
+    {
+        bench_malloc(i, random_size());
+    }
+    read_sample(&s1);
+    report("malloc", n, &s0, &s1);
+
+    shuffle(n);
+    read_sample(&s0);
+    for (i = 0; i < n / 2; ++i)
+    {
+        bench_free(order[i]);
+    }
+    read_sample(&s1);
+    report("free", n / 2, &s0, &s1);
+
+    read_sample(&s0);
+    for (i = 0; i < n / 2; ++i)
+    {
+        bench_malloc(order[i], random_size());
+    }
+    read_sample(&s1);
+    report("refill", n / 2, &s0, &s1);
+
+    shuffle(n);
+    read_sample(&s0);
+    for (i = 0; i < n; ++i)
+    {
+        bench_free(order[i]);
+    }
+    read_sample(&s1);
+    report("free_all", n, &s0, &s1);
+}
+
+/*
+ * realloc: many buffers grown side by side by half their size at a time,
+ *          the way vectors and string builders grow.
+ */
+static void bench_realloc_grow(void)
+{
+    size_t n = 1000, steps = 16;
+    size_t i, k, ops = 0;
+    sample_t s0, s1;
+
+    for (i = 0; i < n; ++i)
+    {
+        bench_malloc(i, 16);
+    }
+    read_sample(&s0);
+    for (k = 0; k < steps; ++k)
+    {
+        for (i = 0; i < n; ++i)
+        {
+            bench_realloc(i, slot_size[i] + slot_size[i] / 2 + 1);
+            ++ops;
+        }
+    }
+    read_sample(&s1);
+    report("realloc", ops, &s0, &s1);
+    for (i = 0; i < n; ++i)
+    {
+        bench_free(i);
+    }
+}
+
+/*
+ * lifetimes: long-lived objects interleaved with short-lived ones, then
+ *            the short-lived ones churned between the survivors.
+ */
+static void bench_lifetimes(void)
+{
+    size_t n = 30000 * scale, rounds = 10;
+    size_t i, r;
+    sample_t zero, mallocs, frees, s0, s1;
+
+    read_sample(&s0);
+    for (i = 0; i < 2 * n; ++i)
+    {
+        bench_malloc(i, (i % 2) ? random_size() : 48);
+    }
+    read_sample(&s1);
+    report("malloc", 2 * n, &s0, &s1);
+
+    read_sample(&s0);
+    for (i = 1; i < 2 * n; i += 2)
+    {
+        bench_free(i);
+    }
+    read_sample(&s1);
+    report("free_short", n, &s0, &s1);
+
+    memset(&zero, 0, sizeof(zero));
+    mallocs = zero;
+    frees = zero;
+    for (r = 0; r < rounds; ++r)
+    {
+        read_sample(&s0);
+        for (i = 1; i < 2 * n; i += 2)
+        {
+            bench_malloc(i, random_size());
+        }
+        read_sample(&s1);
+        accumulate(&mallocs, &s0, &s1);
+
+        read_sample(&s0);
+        for (i = 1; i < 2 * n; i += 2)
+        {
+            bench_free(i);
+        }
+        read_sample(&s1);
+        accumulate(&frees, &s0, &s1);
+    }
+    report("churn_malloc", n * rounds, &zero, &mallocs);
+    report("churn_free", n * rounds, &zero, &frees);
+
+    for (i = 0; i < 2 * n; i += 2)
+    {
+        bench_free(i);
+    }
+}
+
+/*
+ * deep: leaves a long free list of equal holes pinned apart by live blocks,
+ *       then asks for blocks just too big for the holes, so every find_fit
+ *       walks the whole list before moving on to the next class.
+ */
+static void bench_deep(void)
+{
+    size_t n = 20000 * scale, probes = 2000;
+    size_t i;
+    sample_t s0, s1;
+
+    for (i = 0; i < 2 * n; ++i)
+    {
+        bench_malloc(i, 200);
+    }
+    for (i = 0; i < 2 * n; i += 2)
+    {
+        bench_free(i);
+    }
+
+    read_sample(&s0);
+    for (i = 0; i < probes; ++i)
+    {
+        bench_malloc(2 * n + i, 240);
+    }
+    read_sample(&s1);
+    report("malloc_miss", probes, &s0, &s1);
+
+    read_sample(&s0);
+    for (i = 0; i < 2 * n; i += 2)
+    {
+        bench_malloc(i, 200);
+    }
+    read_sample(&s1);
+    report("malloc_hit", n, &s0, &s1);
+
+    for (i = 0; i < 2 * n + probes; ++i)
+    {
+        bench_free(i);
+    }
+}
+
+typedef struct
+{
+    const char *name;
+    void (*run)(void);
+    size_t slots;   // entries needed in the slot table, before scaling
+} bench_t;
+
+static const bench_t benches[] =
+{
+    { "churn",     bench_churn,        50000 },
+    { "fixed",     bench_fixed,        50000 },
+    { "random",    bench_random,       40000 },
+    { "realloc",   bench_realloc_grow, 1000 },
+    { "lifetimes", bench_lifetimes,    60000 },
+    { "deep",      bench_deep,         42000 },
+};
+static const size_t nbenches = sizeof(benches) / sizeof(benches[0]);
+
+static void run_bench(const bench_t *b)
+{
+    size_t n = b->slots * scale;
+
+    slots = calloc(n, sizeof(char *));
+    slot_size = calloc(n, sizeof(size_t));
+    order = calloc(n, sizeof(size_t));
+    if (slots == NULL || slot_size == NULL || order == NULL)
+    {
+        fprintf(stderr, "mmbench: out of memory\n");
+        exit(1);
+    }
+
+    workload = b->name;
+    live_bytes = 0;
+    peak_live = 0;
+    mem_reset_brk();
+    if (!mm_init())
+    {
+        fprintf(stderr, "mmbench: mm_init failed\n");
+        exit(1);
+    }
+    if (setjmp(bench_abort) == 0)
+    {
+        b->run();
+    }
+    else
+    {
+        printf("{\"workload\":\"%s\",\"error\":\"out of memory\"}\n",
+               workload);
+        fflush(stdout);
+    }
+
+    free(slots);
+    free(slot_size);
+    free(order);
+}
+
+static void usage(void)
+{
+    size_t i;
+    fprintf(stderr, "usage: mmbench [-n scale] [-s seed] [workload ...]\n");
+    fprintf(stderr, "workloads:");
+    for (i = 0; i < nbenches; ++i)
+    {
+        fprintf(stderr, " %s", benches[i].name);
+    }
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int c;
+    size_t i;
+
+    while ((c = getopt(argc, argv, "n:s:h")) != -1)
+    {
+        switch (c)
+        {
+        case 'n':
+            scale = (size_t)strtoul(optarg, NULL, 10);
+            if (scale == 0)
+            {
+                usage();
+            }
+            break;
+        case 's':
+            rng_state = strtoull(optarg, NULL, 10) | 1;
+            break;
+        default:
+            usage();
+        }
+    }
+
+    mem_init();
+    open_counters();
+
+    if (optind == argc)
+    {
+        for (i = 0; i < nbenches; ++i)
+        {
+            run_bench(&benches[i]);
+        }
+        return 0;
+    }
+
+    for (; optind < argc; ++optind)
+    {
+        for (i = 0; i < nbenches; ++i)
+        {
+            if (strcmp(argv[optind], benches[i].name) == 0)
+            {
+                break;
+            }
+        }
+        if (i == nbenches)
+        {
+            usage();
+        }
+        run_bench(&benches[i]);
+    }
+    return 0;
+}
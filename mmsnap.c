@@ -0,0 +1,278 @@
+/*
+ * mmsnap.c
+ * Offline viewer for heap snapshots written by mm_snapshot.
+ *
+ *     gcc -O2 -o mmsnap mmsnap.c
+ *     mmsnap [-w width] [-r rows] [snapshot]
+ *
+ * Reads the snapshot from the file, or from stdin, and prints:
+ *   - a summary of allocated and free memory, including the free bytes
+ *     stranded below the highest allocated block, which the heap can
+ *     never give back;
+ *   - a fragmentation map, one character per slice of the heap showing
+ *     how much of it is allocated;
+ *   - the distribution of free blocks over the segregated lists.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "mm_ext.h"
+
+typedef struct
+{
+    uint64_t blocks;
+    uint64_t bytes;
+} tally_t;
+
+static const char map_chars[] = ".-+#";
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: mmsnap [-w width] [-r rows] [snapshot]\n");
+    exit(1);
+}
+
+/*
+ * class_start: the smallest block size that mm_size_class puts in bin or
+ *              above, found by bisection since the classes only grow with
+ *              the size.
+ */
+static size_t class_start(int bin)
+{
+    size_t lo = 1, hi = SIZE_MAX;
+
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (mm_size_class(mid) >= bin)
+        {
+            hi = mid;
+        }
+        else
+        {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+/*
+ * bin_label: writes the size range of a segregated list, as in blockindex.
+ */
+static void bin_label(int bin, char *buf, size_t len)
+{
+    if (bin == 0)
+    {
+        snprintf(buf, len, "<= %zu", class_start(1) - 1);
+    }
+    else if (bin == MM_NUM_CLASSES - 1)
+    {
+        snprintf(buf, len, "> %zu", class_start(bin) - 1);
+    }
+    else
+    {
+        snprintf(buf, len, "%zu-%zu", class_start(bin), class_start(bin + 1) - 1);
+    }
+}
+
+/*
+ * add_alloc: adds the allocated bytes in [start, start+len) to the map.
+ */
+static void add_alloc(uint64_t *cells, size_t ncells, uint64_t cell_bytes,
+                      uint64_t start, uint64_t len)
+{
+    uint64_t stop = start + len;
+
+    while (start < stop)
+    {
+        size_t c = (size_t)(start / cell_bytes);
+        if (c >= ncells)
+        {
+            break;
+        }
+        uint64_t cend = (c + 1) * cell_bytes;
+        uint64_t n = ((stop < cend) ? stop : cend) - start;
+        cells[c] += n;
+        start += n;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t width = 64, rows = 16;
+    int c;
+
+    while ((c = getopt(argc, argv, "w:r:h")) != -1)
+    {
+        switch (c)
+        {
+        case 'w':
+            width = (size_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            rows = (size_t)strtoul(optarg, NULL, 10);
+            break;
+        default:
+            usage();
+        }
+    }
+    if (width == 0 || rows == 0 || argc - optind > 1)
+    {
+        usage();
+    }
+
+    FILE *in = stdin;
+    if (optind < argc && (in = fopen(argv[optind], "rb")) == NULL)
+    {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    mm_snap_header_t hdr;
+    if (fread(&hdr, sizeof(hdr), 1, in) != 1 || hdr.magic != MM_SNAP_MAGIC)
+    {
+        fprintf(stderr, "mmsnap: not a heap snapshot\n");
+        return 1;
+    }
+
+    size_t ncells = width * rows;
+    uint64_t cell_bytes = (hdr.heap_size + ncells - 1) / ncells;
+    cell_bytes = (cell_bytes + 15) / 16 * 16;
+    if (cell_bytes == 0)
+    {
+        cell_bytes = 16;
+    }
+    uint64_t *cells = calloc(ncells, sizeof(uint64_t));
+    if (cells == NULL)
+    {
+        fprintf(stderr, "mmsnap: out of memory\n");
+        return 1;
+    }
+
+    tally_t alloc = { 0, 0 };
+    tally_t freed = { 0, 0 };
+    tally_t bins[MM_NUM_CLASSES];
+    uint64_t largest_free = 0;
+    uint64_t alloc_top = 0;      // end of the highest allocated block
+    uint64_t free_below = 0;     // free bytes seen before alloc_top
+    uint64_t free_pending = 0;   // free bytes seen since then
+    uint64_t records = 0;
+    mm_snap_record_t rec;
+
+    memset(bins, 0, sizeof(bins));
+    while (fread(&rec, sizeof(rec), 1, in) == 1)
+    {
+        uint64_t bytes = rec.size * rec.count;
+        ++records;
+        if (rec.alloc)
+        {
+            alloc.blocks += rec.count;
+            alloc.bytes += bytes;
+            add_alloc(cells, ncells, cell_bytes, rec.offset, bytes);
+            alloc_top = rec.offset + bytes;
+            free_below += free_pending;
+            free_pending = 0;
+        }
+        else
+        {
+            freed.blocks += rec.count;
+            freed.bytes += bytes;
+            free_pending += bytes;
+            if (rec.size > largest_free)
+            {
+                largest_free = rec.size;
+            }
+            if (rec.bin >= 0 && rec.bin < MM_NUM_CLASSES)
+            {
+                bins[rec.bin].blocks += rec.count;
+                bins[rec.bin].bytes += bytes;
+            }
+        }
+    }
+
+    printf("heap size       %llu bytes in %llu records\n",
+           (unsigned long long)hdr.heap_size, (unsigned long long)records);
+    printf("allocated       %llu bytes in %llu blocks\n",
+           (unsigned long long)alloc.bytes, (unsigned long long)alloc.blocks);
+    printf("free            %llu bytes in %llu blocks\n",
+           (unsigned long long)freed.bytes, (unsigned long long)freed.blocks);
+    printf("largest free    %llu bytes\n", (unsigned long long)largest_free);
+    printf("stranded free   %llu bytes below the top allocated block at %llu\n",
+           (unsigned long long)free_below, (unsigned long long)alloc_top);
+    if (freed.bytes > 0)
+    {
+        printf("fragmentation   %.4f (1 - largest free / free)\n",
+               1.0 - (double)largest_free / (double)freed.bytes);
+    }
+    if (hdr.heap_size > 0)
+    {
+        printf("utilization     %.4f\n",
+               (double)alloc.bytes / (double)hdr.heap_size);
+    }
+
+    printf("\nmap: %llu bytes per cell, '%c' empty .. '%c' full\n",
+           (unsigned long long)cell_bytes, map_chars[0],
+           map_chars[sizeof(map_chars) - 2]);
+    size_t i;
+    for (i = 0; i < ncells; ++i)
+    {
+        uint64_t start = i * cell_bytes;
+        if (start >= hdr.heap_size)
+        {
+            break;
+        }
+        if (i % width == 0)
+        {
+            printf("%12llu ", (unsigned long long)start);
+        }
+        uint64_t span = hdr.heap_size - start;
+        span = (span < cell_bytes) ? span : cell_bytes;
+        size_t level = (size_t)(cells[i] * (sizeof(map_chars) - 1) / (span + 1));
+        putchar(map_chars[level]);
+        if (i % width == width - 1)
+        {
+            putchar('\n');
+        }
+    }
+    if (i % width != 0)
+    {
+        putchar('\n');
+    }
+
+    uint64_t most = 0;
+    int b;
+    for (b = 0; b < MM_NUM_CLASSES; ++b)
+    {
+        most = (bins[b].bytes > most) ? bins[b].bytes : most;
+    }
+    printf("\nfree blocks by list\n");
+    for (b = 0; b < MM_NUM_CLASSES; ++b)
+    {
+        char label[48];
+        if (bins[b].blocks == 0)
+        {
+            continue;
+        }
+        bin_label(b, label, sizeof(label));
+        printf("%2d %-22s %10llu blocks %14llu bytes ", b, label,
+               (unsigned long long)bins[b].blocks,
+               (unsigned long long)bins[b].bytes);
+        int bar = (int)(bins[b].bytes * 40 / most);
+        while (bar-- > 0)
+        {
+            putchar('*');
+        }
+        putchar('\n');
+    }
+
+    free(cells);
+    if (in != stdin)
+    {
+        fclose(in);
+    }
+    return 0;
+}